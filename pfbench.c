@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "pixelflut.h"
+
+#define PANIC(msg) do { fprintf(stderr, "%s\n", msg); exit(EXIT_FAILURE); } while (0)
+#define ASSERT(cond, msg) do { if (!(cond)) PANIC(msg); } while (0)
+#define PF_ASSERT(expr, msg) do { \
+    if ((res = (expr))) { \
+        fprintf(stderr, "%s: %s\n", msg, pf_error_msg(res)); \
+        exit(EXIT_FAILURE); \
+    } \
+} while (0)
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// side length of the square region (at the top left of the canvas) used for benchmarking
+#define REGION_SIZE 64
+#define MAX_CONNS 64
+#define DEFAULT_CONN_LIMIT 8
+#define RTT_SAMPLES 32
+#define HELP_TIMEOUT_MS 300
+// I/O timeout of all connections, in steps, but at least `MIN_IO_TIMEOUT` seconds
+#define IO_TIMEOUT_STEPS 4
+#define MIN_IO_TIMEOUT 1.0
+
+static const size_t buf_sizes[] = { 512, 4096, 16384, 65536 };
+static const size_t batch_limits[] = { 0, 64, 256, 1024 };
+
+static char *address;
+static char *port;
+static double step_seconds = 0.25;
+
+static double
+now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int
+cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Makes a stalled connection (e.g. a server that stops answering because its send
+// buffer is full, or that serves one client at a time) fail with
+// `PF_SYS_READ`/`PF_SYS_WRITE` instead of hanging.
+static void
+set_timeouts(struct pf_conn *conn) {
+    double seconds = IO_TIMEOUT_STEPS * step_seconds;
+    if (seconds < MIN_IO_TIMEOUT) {
+        seconds = MIN_IO_TIMEOUT;
+    }
+    struct timeval tv = {
+        .tv_sec = (time_t)seconds,
+        .tv_usec = (suseconds_t)((seconds - (double)(time_t)seconds) * 1e6)
+    };
+    setsockopt(conn->sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(conn->sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// --- probing ---
+
+struct probe {
+    uint16_t width;
+    uint16_t height;
+    double rtt_min;
+    double rtt_median;
+    bool gray;
+    // whether the server answered `HELP` at all
+    bool help;
+    bool pb;
+    bool offset;
+    size_t max_conns;
+};
+
+static void
+probe_rtt(struct pf_conn *conn, struct probe *p) {
+    enum pf_result res;
+    double samples[RTT_SAMPLES];
+    for (size_t i = 0; i < RTT_SAMPLES; i++) {
+        struct pixel px = { 0 };
+        double start = now();
+        PF_ASSERT(pf_get(conn, &px), "could not get pixel");
+        samples[i] = now() - start;
+    }
+    qsort(samples, RTT_SAMPLES, sizeof(samples[0]), cmp_double);
+    p->rtt_min = samples[0];
+    p->rtt_median = samples[RTT_SAMPLES / 2];
+}
+
+// Writes a gray pixel and checks whether it reads back as such.
+// Servers that don't know the short form ignore it or kick us, both count as unsupported.
+static void
+probe_gray(struct pf_conn *conn, struct probe *p) {
+    struct pixel orig = { 0 };
+    if (pf_get(conn, &orig) != PF_OK) {
+        return;
+    }
+    struct pixel px = orig;
+    px.r = px.g = px.b = orig.r ^ 0x80;
+    struct pixel check = { 0 };
+    if (pf_put_gray(conn, px) != PF_OK || pf_get(conn, &check) != PF_OK) {
+        return;
+    }
+    p->gray = check.r == px.r && check.g == px.r && check.b == px.r;
+    pf_put_rgb(conn, orig);
+}
+
+// There's no generic way to detect `PB` or `OFFSET`, so we rely on the `HELP` text.
+static void
+probe_help(struct pf_conn *conn, struct probe *p) {
+    if (send(conn->sockfd, "HELP\n", 5, MSG_NOSIGNAL) != 5) {
+        return;
+    }
+    char text[4096];
+    size_t len = 0;
+    struct pollfd pfd = { .fd = conn->sockfd, .events = POLLIN };
+    while (len < sizeof(text) - 1 && poll(&pfd, 1, HELP_TIMEOUT_MS) == 1) {
+        ssize_t status = read(conn->sockfd, text + len, sizeof(text) - 1 - len);
+        if (status <= 0) {
+            break;
+        }
+        len += (size_t)status;
+    }
+    text[len] = '\0';
+    p->help = len > 0;
+    p->pb = strstr(text, "PB") != NULL;
+    p->offset = strstr(text, "OFFSET") != NULL;
+}
+
+// Opens connections until the server refuses or stops answering, up to `limit`.
+static void
+probe_max_conns(size_t limit, struct probe *p) {
+    struct pf_conn conns[MAX_CONNS];
+    size_t n = 0;
+    while (n < limit) {
+        if (pf_connect_raw(address, port, &conns[n]) != PF_OK) {
+            break;
+        }
+        // a timeout here means the server accepted, but won't serve us
+        set_timeouts(&conns[n]);
+        if (pf_get_size(&conns[n], NULL, NULL) != PF_OK) {
+            break;
+        }
+        n++;
+    }
+    for (size_t i = 0; i < n; i++) {
+        pf_disconnect(&conns[i]);
+    }
+    p->max_conns = n;
+}
+
+static struct probe
+probe_server(size_t conn_limit) {
+    struct probe p = { 0 };
+    struct pf_conn conn;
+    enum pf_result res;
+    PF_ASSERT(pf_connect_raw(address, port, &conn), "could not establish connection");
+    set_timeouts(&conn);
+    PF_ASSERT(pf_get_size(&conn, &p.width, &p.height), "could not get size");
+    ASSERT(p.width > 0 && p.height > 0, "server reported empty canvas");
+    probe_rtt(&conn, &p);
+    pf_disconnect(&conn);
+
+    // these may get us kicked, so each gets its own connection
+    if (pf_connect_raw(address, port, &conn) == PF_OK) {
+        set_timeouts(&conn);
+        probe_gray(&conn, &p);
+        pf_disconnect(&conn);
+    }
+    if (pf_connect_raw(address, port, &conn) == PF_OK) {
+        set_timeouts(&conn);
+        probe_help(&conn, &p);
+        pf_disconnect(&conn);
+    }
+    probe_max_conns(conn_limit, &p);
+    return p;
+}
+
+// --- throughput ---
+
+enum bench_op {
+    OP_PUT,
+    OP_GET,
+};
+
+struct bench_config {
+    enum bench_op op;
+    enum pf_format fmt;
+    size_t conns;
+    size_t buf_size;
+    size_t batch_limit;
+};
+
+struct worker {
+    pthread_t thread;
+    struct pf_conn conn;
+    const struct bench_config *cfg;
+    struct pixel *pxs;
+    size_t n;
+    char *buf;
+    double deadline;
+
+    // time at which the server had processed everything we sent
+    double end;
+    size_t pixels;
+    enum pf_result res;
+};
+
+static void *
+worker_run(void *arg) {
+    struct worker *w = arg;
+    const struct bench_config *cfg = w->cfg;
+    while (now() < w->deadline) {
+        if (cfg->op == OP_PUT) {
+            w->res = pf_put_many(&w->conn, w->pxs, w->n, cfg->fmt, w->buf, cfg->buf_size);
+        } else {
+            w->res = pf_get_many(&w->conn, w->pxs, w->n, w->buf, cfg->buf_size, cfg->batch_limit);
+        }
+        if (w->res != PF_OK) {
+            break;
+        }
+        w->pixels += w->n;
+    }
+    // writes only reach the kernel; a round trip makes sure the server processed them
+    if (w->res == PF_OK) {
+        w->res = pf_get_size(&w->conn, NULL, NULL);
+    }
+    w->end = now();
+    return NULL;
+}
+
+// Returns the measured pixels/s, or a negative value if any connection failed.
+static double
+run_config(const struct bench_config *cfg, struct pixel *region, size_t n) {
+    struct worker workers[MAX_CONNS];
+    memset(workers, 0, sizeof(workers));
+    for (size_t i = 0; i < cfg->conns; i++) {
+        workers[i].conn.sockfd = -1;
+    }
+    size_t started = 0;
+    double rate = -1;
+
+    for (size_t i = 0; i < cfg->conns; i++) {
+        struct worker *w = &workers[i];
+        w->cfg = cfg;
+        w->n = n;
+        w->pxs = malloc(n * sizeof(*w->pxs));
+        w->buf = malloc(cfg->buf_size);
+        ASSERT(w->pxs != NULL && w->buf != NULL, "out of memory");
+        memcpy(w->pxs, region, n * sizeof(*w->pxs));
+        if ((w->res = pf_connect_raw(address, port, &w->conn)) != PF_OK) {
+            goto cleanup;
+        }
+        set_timeouts(&w->conn);
+    }
+
+    double start = now();
+    for (size_t i = 0; i < cfg->conns; i++) {
+        workers[i].deadline = start + step_seconds;
+        ASSERT(pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) == 0,
+            "could not create thread");
+        started++;
+    }
+    size_t pixels = 0;
+    double end = start;
+    bool failed = false;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pixels += workers[i].pixels;
+        end = workers[i].end > end ? workers[i].end : end;
+        failed = failed || workers[i].res != PF_OK;
+    }
+    if (!failed) {
+        rate = (double)pixels / (end - start);
+    }
+
+cleanup:
+    for (size_t i = 0; i < cfg->conns; i++) {
+        if (workers[i].res != PF_OK) {
+            fprintf(stderr, "  connection %zu failed: %s\n", i, pf_error_msg(workers[i].res));
+        }
+        pf_disconnect(&workers[i].conn);
+        free(workers[i].pxs);
+        free(workers[i].buf);
+    }
+    return rate;
+}
+
+static const char *
+format_name(enum pf_format fmt) {
+    switch (fmt) {
+        case PF_FORMAT_GRAY: return "gray";
+        case PF_FORMAT_RGB: return "rgb";
+        case PF_FORMAT_RGBA: return "rgba";
+        case PF_FORMAT_RGBA_OPAQUE: return "rgba-opaque";
+    }
+    return "?";
+}
+
+static void
+print_result(const struct bench_config *cfg, double rate) {
+    if (cfg->op == OP_PUT) {
+        printf("  put %-11s conns=%-2zu buf=%-6zu", format_name(cfg->fmt), cfg->conns, cfg->buf_size);
+    } else {
+        printf("  get conns=%-2zu buf=%-6zu batch=%-5zu", cfg->conns, cfg->buf_size, cfg->batch_limit);
+    }
+    if (rate < 0) {
+        printf("  failed\n");
+    } else {
+        printf("  %12.0f px/s\n", rate);
+    }
+}
+
+// Runs `cfg` and keeps it in `*best` if it's faster.
+static void
+measure(struct bench_config cfg, struct pixel *region, size_t n,
+    struct bench_config *best, double *best_rate)
+{
+    double rate = run_config(&cfg, region, n);
+    print_result(&cfg, rate);
+    if (rate > *best_rate) {
+        *best = cfg;
+        *best_rate = rate;
+    }
+}
+
+// Connection counts are swept in doubling steps, ending exactly at `max`.
+static size_t
+next_conns(size_t conns, size_t max) {
+    return conns < max && conns * 2 > max ? max : conns * 2;
+}
+
+int main(int argc, char *argv[]) {
+    ASSERT(argc >= 3, "arguments: <address> <port> [seconds per step] [max connections]");
+    address = argv[1];
+    port = argv[2];
+    if (argc >= 4) {
+        step_seconds = atof(argv[3]);
+        ASSERT(step_seconds > 0, "seconds per step must be positive");
+    }
+    size_t conn_limit = DEFAULT_CONN_LIMIT;
+    if (argc >= 5) {
+        conn_limit = strtoul(argv[4], NULL, 10);
+        ASSERT(conn_limit > 0 && conn_limit <= MAX_CONNS, "max connections must be in 1.." STR(MAX_CONNS));
+    }
+
+    struct probe p = probe_server(conn_limit);
+    printf("server %s:%s\n", address, port);
+    printf("  SIZE %d %d\n", p.width, p.height);
+    printf("  RTT min %.3f ms, median %.3f ms\n", p.rtt_min * 1e3, p.rtt_median * 1e3);
+    printf("  grayscale: %s\n", p.gray ? "yes" : "no");
+    if (p.help) {
+        printf("  PB: %s, OFFSET: %s (according to HELP)\n",
+            p.pb ? "yes" : "no", p.offset ? "yes" : "no");
+    } else {
+        printf("  PB, OFFSET: unknown (no HELP response)\n");
+    }
+    printf("  connections: %zu%s\n", p.max_conns, p.max_conns == conn_limit ? " (limit reached)" : "");
+    ASSERT(p.max_conns > 0, "server accepts no benchmark connections");
+
+    // gray values, so that every format encodes the same image
+    size_t w = p.width < REGION_SIZE ? p.width : REGION_SIZE;
+    size_t h = p.height < REGION_SIZE ? p.height : REGION_SIZE;
+    size_t n = w * h;
+    struct pixel region[REGION_SIZE * REGION_SIZE];
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+            uint8_t v = (uint8_t)(x + y);
+            region[y * w + x] = (struct pixel){ .x = x, .y = y, .r = v, .g = v, .b = v, .a = 0xff };
+        }
+    }
+
+    printf("put sweep (%zu pixels per call)\n", n);
+    struct bench_config best_put = { 0 };
+    double best_put_rate = -1;
+    for (size_t c = 1; c <= p.max_conns; c = next_conns(c, p.max_conns)) {
+        for (size_t b = 0; b < ARRAY_LEN(buf_sizes); b++) {
+            struct bench_config cfg = {
+                .op = OP_PUT, .fmt = PF_FORMAT_RGB, .conns = c, .buf_size = buf_sizes[b]
+            };
+            measure(cfg, region, n, &best_put, &best_put_rate);
+        }
+    }
+    if (best_put_rate > 0) {
+        enum pf_format fmts[] = { PF_FORMAT_RGBA, PF_FORMAT_GRAY };
+        for (size_t f = 0; f < ARRAY_LEN(fmts); f++) {
+            if (fmts[f] == PF_FORMAT_GRAY && !p.gray) {
+                continue;
+            }
+            struct bench_config cfg = best_put;
+            cfg.fmt = fmts[f];
+            measure(cfg, region, n, &best_put, &best_put_rate);
+        }
+    }
+
+    printf("get sweep (%zu pixels per call)\n", n);
+    struct bench_config best_get = { 0 };
+    double best_get_rate = -1;
+    for (size_t c = 1; c <= p.max_conns; c = next_conns(c, p.max_conns)) {
+        for (size_t b = 0; b < ARRAY_LEN(buf_sizes); b++) {
+            for (size_t l = 0; l < ARRAY_LEN(batch_limits); l++) {
+                struct bench_config cfg = {
+                    .op = OP_GET, .conns = c, .buf_size = buf_sizes[b],
+                    .batch_limit = batch_limits[l]
+                };
+                measure(cfg, region, n, &best_get, &best_get_rate);
+            }
+        }
+    }
+
+    printf("recommended configuration\n");
+    if (best_put_rate > 0) {
+        printf("  put: pf_put_many(%s), buf_size=%zu, %zu connection(s): %.0f px/s\n",
+            format_name(best_put.fmt), best_put.buf_size, best_put.conns, best_put_rate);
+    } else {
+        printf("  put: no working configuration\n");
+    }
+    if (best_get_rate > 0) {
+        printf("  get: pf_get_many, buf_size=%zu, batch_limit=%zu, %zu connection(s): %.0f px/s\n",
+            best_get.buf_size, best_get.batch_limit, best_get.conns, best_get_rate);
+    } else {
+        printf("  get: no working configuration\n");
+    }
+    printf("  RTT: %.3f ms\n", p.rtt_median * 1e3);
+}
@@ -7,6 +7,7 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #include "pixelflut.h"
@@ -18,53 +19,69 @@
     }                           \
 } while (0)
 
-enum pf_result
-pf_connect_raw(char *addr, char *port, struct pf_conn *conn) {
-    if (addr == NULL || port == NULL || conn == NULL) {
-        return PF_NULL_ARG;
-    }
-    // 0-initialize all members
-    memset(conn, 0, sizeof(*conn));
-    conn->sockfd = -1;
-    enum pf_result res = PF_OK;
-
+// parses a numbers-and-dots IPv4 address and a port string into `sock_addr`.
+static enum pf_result
+parse_addr(char *addr, char *port, struct sockaddr_in *sock_addr) {
     struct in_addr ip_addr;
     if (!inet_aton(addr, &ip_addr)) {
-        res = PF_CONNECT_PARSE_ADDR;
-        goto fail;
+        return PF_CONNECT_PARSE_ADDR;
     }
 
     errno = 0;    /* To distinguish success/failure after call */
     char *endptr = NULL;
     unsigned long parsed_port = strtoul(port, &endptr, 10);
     if (errno != 0 || *endptr != '\0' || parsed_port > 0xffff) {
-        res = PF_CONNECT_PARSE_PORT;
-        goto fail;
+        return PF_CONNECT_PARSE_PORT;
     }
 
-    conn->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (conn->sockfd == -1) {
-        res = PF_SYS_SOCKET;
-        goto fail;
-    }
+    memset(sock_addr, 0, sizeof(*sock_addr));
+    sock_addr->sin_family = AF_INET;
+    sock_addr->sin_port = htons((uint16_t)parsed_port);
+    sock_addr->sin_addr = ip_addr;
+    return PF_OK;
+}
 
-    struct sockaddr_in sock_addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons((uint16_t)parsed_port),
-        .sin_addr = ip_addr
-    };
+// opens a socket and connects it to `sock_addr`.
+// With `fastopen`, the handshake is deferred to the first write and the request
+// data travels in the SYN (if supported by kernel and server).
+static enum pf_result
+open_socket(struct sockaddr_in *sock_addr, bool fastopen, int *sockfd) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return PF_SYS_SOCKET;
+    }
+#ifdef TCP_FASTOPEN_CONNECT
+    if (fastopen) {
+        int one = 1;
+        // failure is fine, we just get a regular handshake
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one));
+    }
+#else
+    (void)fastopen;
+#endif
+    if (connect(fd, (struct sockaddr *)sock_addr, sizeof(*sock_addr)) == -1) {
+        close(fd);
+        return PF_SYS_CONNECT;
+    }
+    *sockfd = fd;
+    return PF_OK;
+}
 
-    int status = connect(conn->sockfd, (struct sockaddr *)&sock_addr, sizeof(sock_addr));
-    if (status == -1) {
-        res = PF_SYS_CONNECT;
-        goto fail;
+enum pf_result
+pf_connect_raw(char *addr, char *port, struct pf_conn *conn) {
+    if (addr == NULL || port == NULL || conn == NULL) {
+        return PF_NULL_ARG;
     }
+    // 0-initialize all members
+    memset(conn, 0, sizeof(*conn));
+    conn->sockfd = -1;
+    enum pf_result res = PF_OK;
 
-    return PF_OK;
-    
-fail:
-    DO_CLOSE(conn);
-    return res;
+    struct sockaddr_in sock_addr;
+    if ((res = parse_addr(addr, port, &sock_addr)) != PF_OK) {
+        return res;
+    }
+    return open_socket(&sock_addr, false, &conn->sockfd);
 }
 
 void
@@ -78,7 +95,8 @@ pf_disconnect(struct pf_conn *conn) {
 
 static ssize_t
 do_write_single(int fd, char *buf, size_t len) {
-    ssize_t status = write(fd, buf, len);
+    // MSG_NOSIGNAL: a server closing the connection should be an error, not a SIGPIPE
+    ssize_t status = send(fd, buf, len, MSG_NOSIGNAL);
 #ifdef MONITOR_SYSCALLS
     if (status == -1) {
         perror("MONITOR: failed write syscall");
@@ -119,20 +137,107 @@ write_all(int fd, char *buf, size_t len) {
     return PF_OK;
 }
 
+// --- encoders ---
+// One encoder per color format, so that the per-pixel loops don't have to branch
+// on the format. They write a complete command (including the newline) to `start`
+// and return its length, which is at most `MAX_PUT_LEN`.
+
+#define MAX_PUT_LEN (sizeof("PX 65535 65535 rrggbbaa\n") - 1)
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static inline char *
+encode_hex8(char *p, uint8_t v) {
+    p[0] = hex_digits[v >> 4];
+    p[1] = hex_digits[v & 0xf];
+    return p + 2;
+}
+
+static inline char *
+encode_dec16(char *p, uint16_t v) {
+    char tmp[5];
+    int len = 0;
+    do {
+        tmp[len++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (len > 0) {
+        *p++ = tmp[--len];
+    }
+    return p;
+}
+
+static inline char *
+encode_coords(char *p, struct pixel px) {
+    memcpy(p, "PX ", 3);
+    p = encode_dec16(p + 3, px.x);
+    *p++ = ' ';
+    p = encode_dec16(p, px.y);
+    *p++ = ' ';
+    return p;
+}
+
+#define DEFINE_ENCODER(name, encode_color)              \
+static inline size_t                                    \
+encode_##name(char *start, struct pixel px) {           \
+    char *p = encode_coords(start, px);                 \
+    encode_color                                        \
+    *p++ = '\n';                                        \
+    return (size_t)(p - start);                         \
+}
+
+#define ENCODE_RGB \
+    p = encode_hex8(p, px.r); p = encode_hex8(p, px.g); p = encode_hex8(p, px.b);
+
+DEFINE_ENCODER(gray, p = encode_hex8(p, px.r);)
+DEFINE_ENCODER(rgb, ENCODE_RGB)
+DEFINE_ENCODER(rgba, ENCODE_RGB p = encode_hex8(p, px.a);)
+DEFINE_ENCODER(rgba_opaque, ENCODE_RGB if (px.a != 0xff) { p = encode_hex8(p, px.a); })
+
+#define FORMAT_VALID(fmt) ((unsigned)(fmt) <= PF_FORMAT_RGBA_OPAQUE)
+
+static size_t
+encode_format(char *start, struct pixel px, enum pf_format fmt) {
+    switch (fmt) {
+        case PF_FORMAT_GRAY: return encode_gray(start, px);
+        case PF_FORMAT_RGB: return encode_rgb(start, px);
+        case PF_FORMAT_RGBA: return encode_rgba(start, px);
+        case PF_FORMAT_RGBA_OPAQUE: return encode_rgba_opaque(start, px);
+    }
+    return 0;
+}
+
+enum pf_format
+pf_pick_format(struct pixel *pxs, size_t n, bool allow_gray) {
+    bool all_gray = allow_gray;
+    bool any_opaque = false;
+    bool any_translucent = false;
+    for (size_t i = 0; i < n && !(any_opaque && any_translucent); i++) {
+        struct pixel px = pxs[i];
+        all_gray = all_gray && px.r == px.g && px.g == px.b;
+        if (px.a == 0xff) {
+            any_opaque = true;
+        } else {
+            any_translucent = true;
+        }
+    }
+    if (!any_translucent) {
+        return all_gray ? PF_FORMAT_GRAY : PF_FORMAT_RGB;
+    }
+    return any_opaque ? PF_FORMAT_RGBA_OPAQUE : PF_FORMAT_RGBA;
+}
+
 static enum pf_result
-pf_put_general(struct pf_conn *conn, struct pixel px, bool use_alpha) {
+pf_put_general(struct pf_conn *conn, struct pixel px, enum pf_format fmt) {
     if (!CONN_VALID(conn)) {
         return PF_CONN_INVALID_STATE;
     }
-    enum pf_result res = PF_OK;
-    char buf[32];
-    int len;
-    // TODO no error handling here, should we do it?
-    if (use_alpha) {
-        len = sprintf(buf, "PX %d %d %02x%02x%02x%02x\n", px.x, px.y, px.r, px.g, px.b, px.a);
-    } else {
-        len = sprintf(buf, "PX %d %d %02x%02x%02x\n", px.x, px.y, px.r, px.g, px.b);
+    if (!FORMAT_VALID(fmt)) {
+        return PF_INVALID_FORMAT;
     }
+    enum pf_result res = PF_OK;
+    char buf[MAX_PUT_LEN];
+    size_t len = encode_format(buf, px, fmt);
 
     if ((res = write_all(conn->sockfd, buf, len)) != PF_OK) {
         goto fail;
@@ -147,12 +252,17 @@ fail:
 
 enum pf_result
 pf_put_rgb(struct pf_conn *conn, struct pixel px) {
-    return pf_put_general(conn, px, false);
+    return pf_put_general(conn, px, PF_FORMAT_RGB);
 }
 
 enum pf_result
 pf_put_rgba(struct pf_conn *conn, struct pixel px) {
-    return pf_put_general(conn, px, true);
+    return pf_put_general(conn, px, PF_FORMAT_RGBA);
+}
+
+enum pf_result
+pf_put_gray(struct pf_conn *conn, struct pixel px) {
+    return pf_put_general(conn, px, PF_FORMAT_GRAY);
 }
 
 struct pf_buf {
@@ -309,6 +419,8 @@ const char *pf_error_msg(enum pf_result res) {
         case PF_OK: return "OK";
         case PF_CONN_INVALID_STATE: return "called function with failed/closed connection";
         case PF_NULL_ARG: return "encountered NULL argument";
+        case PF_INVALID_FORMAT: return "invalid color format";
+        case PF_TOO_MANY_SPARES: return "requested more than PF_MAX_SPARES spare connections";
         case PF_CONNECT_PARSE_ADDR: return "could not parse address";
         case PF_CONNECT_PARSE_PORT: return "could not parse port";
         case PF_SYS_SOCKET: return "could not create socket";
@@ -362,17 +474,61 @@ add_to_buffer(struct pf_conn *conn, struct pf_buf *buf, char *data, size_t n) {
     return PF_OK;
 }
 
+// Defines `put_many_<name>`, the buffered write loop for one encoder.
+// `*flushed` is set to the number of pixels that were completely flushed,
+// also on error. Everything after that has to be sent again.
+// Commands are encoded directly into the buffer, which is flushed whenever
+// the longest possible command wouldn't fit anymore.
+#define DEFINE_PUT_MANY(name)                                                   \
+static enum pf_result                                                           \
+put_many_##name(struct pf_conn *conn, struct pixel *pxs, size_t n,              \
+    struct pf_buf *buf, size_t *flushed)                                        \
+{                                                                               \
+    enum pf_result res = PF_OK;                                                 \
+    size_t i;                                                                   \
+    for (i = 0; i < n; i++) {                                                   \
+        if (buf->cap - buf->len < MAX_PUT_LEN) {                                \
+            if ((res = do_flush(conn, buf)) != PF_OK) {                         \
+                goto fail;                                                      \
+            }                                                                   \
+            conn->num_pixels_written += i - *flushed;                           \
+            *flushed = i;                                                       \
+        }                                                                       \
+        buf->len += encode_##name(buf->data + buf->len, pxs[i]);                \
+    }                                                                           \
+    if ((res = do_flush(conn, buf)) != PF_OK) {                                 \
+        goto fail;                                                              \
+    }                                                                           \
+    conn->num_pixels_written += n - *flushed;                                   \
+    *flushed = n;                                                               \
+    return PF_OK;                                                               \
+fail:                                                                           \
+    conn->num_pixels_lost += i - *flushed;                                      \
+    return res;                                                                 \
+}
+
+DEFINE_PUT_MANY(gray)
+DEFINE_PUT_MANY(rgb)
+DEFINE_PUT_MANY(rgba)
+DEFINE_PUT_MANY(rgba_opaque)
+
+// `*flushed` is set to the number of pixels that were completely flushed,
+// also on error. Everything after that has to be sent again.
 static
 enum pf_result
-pf_put_general_many(struct pf_conn *conn, struct pixel *pxs, size_t n, bool use_alpha,
-    char *buf, size_t buf_size)
+pf_put_general_many(struct pf_conn *conn, struct pixel *pxs, size_t n, enum pf_format fmt,
+    char *buf, size_t buf_size, size_t *flushed)
 {
+    *flushed = 0;
     if (!CONN_VALID(conn)) {
         return PF_CONN_INVALID_STATE;
     }
     if (pxs == NULL || buf == NULL) {
         return PF_NULL_ARG;
     }
+    if (!FORMAT_VALID(fmt)) {
+        return PF_INVALID_FORMAT;
+    }
     if (buf_size < PF_MIN_BUFFER_SIZE) {
         return PF_BUFFER_SIZE;
     }
@@ -383,26 +539,16 @@ pf_put_general_many(struct pf_conn *conn, struct pixel *pxs, size_t n, bool use_
         .data = buf
     };
     enum pf_result res = PF_OK;
-    char printbuf[32];
-    for (size_t i = 0; i < n; i++) {
-        struct pixel px = pxs[i];
-        int len;
-        if (use_alpha) {
-            len = sprintf(printbuf, "PX %d %d %02x%02x%02x%02x\n", px.x, px.y, px.r, px.g, px.b, px.a);
-        } else {
-            len = sprintf(printbuf, "PX %d %d %02x%02x%02x\n", px.x, px.y, px.r, px.g, px.b);
-        }
-        if ((res = add_to_buffer(conn, &real_buf, printbuf, len)) != PF_OK) {
-            goto fail;
-        }
-    }
-    if ((res = do_flush(conn, &real_buf)) != PF_OK) {
-        goto fail;
+    // the format is chosen once per batch, not per pixel
+    switch (fmt) {
+        case PF_FORMAT_GRAY: res = put_many_gray(conn, pxs, n, &real_buf, flushed); break;
+        case PF_FORMAT_RGB: res = put_many_rgb(conn, pxs, n, &real_buf, flushed); break;
+        case PF_FORMAT_RGBA: res = put_many_rgba(conn, pxs, n, &real_buf, flushed); break;
+        case PF_FORMAT_RGBA_OPAQUE: res = put_many_rgba_opaque(conn, pxs, n, &real_buf, flushed); break;
+    }
+    if (res != PF_OK) {
+        DO_CLOSE(conn);
     }
-    conn->num_pixels_written += n;
-    return PF_OK;
-fail:
-    DO_CLOSE(conn);
     return res;
 }
 
@@ -410,14 +556,42 @@ enum pf_result
 pf_put_rgb_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
     char *buf, size_t buf_size)
 {
-    return pf_put_general_many(conn, pxs, n, false, buf, buf_size);
+    size_t flushed;
+    return pf_put_general_many(conn, pxs, n, PF_FORMAT_RGB, buf, buf_size, &flushed);
 }
 
 enum pf_result
 pf_put_rgba_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
     char *buf, size_t buf_size)
 {
-    return pf_put_general_many(conn, pxs, n, true, buf, buf_size);
+    size_t flushed;
+    return pf_put_general_many(conn, pxs, n, PF_FORMAT_RGBA, buf, buf_size, &flushed);
+}
+
+enum pf_result
+pf_put_gray_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size)
+{
+    size_t flushed;
+    return pf_put_general_many(conn, pxs, n, PF_FORMAT_GRAY, buf, buf_size, &flushed);
+}
+
+enum pf_result
+pf_put_many(struct pf_conn *conn, struct pixel *pxs, size_t n, enum pf_format fmt,
+    char *buf, size_t buf_size)
+{
+    size_t flushed;
+    return pf_put_general_many(conn, pxs, n, fmt, buf, buf_size, &flushed);
+}
+
+enum pf_result
+pf_put_auto_many(struct pf_conn *conn, struct pixel *pxs, size_t n, bool allow_gray,
+    char *buf, size_t buf_size)
+{
+    if (pxs == NULL) {
+        return PF_NULL_ARG;
+    }
+    return pf_put_many(conn, pxs, n, pf_pick_format(pxs, n, allow_gray), buf, buf_size);
 }
 
 // receives the n pixels from `pxs[0]` to `pxs[n-1]`.
@@ -463,11 +637,14 @@ pf_get_many_recv(struct pf_conn *conn, struct pixel *pxs, size_t n,
     return PF_OK;
 }
 
-enum pf_result
-pf_get_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
+// `*answered` is set to the number of pixels whose responses were completely received,
+// also on error. Everything after that has to be requested again.
+static enum pf_result
+pf_get_many_resumable(struct pf_conn *conn, struct pixel *pxs, size_t n,
     char *buf, size_t buf_size,
-    size_t batch_limit)
+    size_t batch_limit, size_t *answered)
 {
+    *answered = 0;
     if (!CONN_VALID(conn)) {
         return PF_CONN_INVALID_STATE;
     }
@@ -501,7 +678,9 @@ pf_get_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
             if ((res = pf_get_many_recv(conn, pxs + curr_batch_start, batch_limit, buf, buf_size))) {
                 goto fail;
             }
+            conn->num_pixels_read += batch_limit;
             curr_batch_start = idx;
+            *answered = idx;
         }
     }
     if (idx > curr_batch_start) {
@@ -511,11 +690,239 @@ pf_get_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
         if ((res = pf_get_many_recv(conn, pxs + curr_batch_start, idx - curr_batch_start, buf, buf_size))) {
             goto fail;
         }
+        conn->num_pixels_read += idx - curr_batch_start;
+        *answered = idx;
     }
-    conn->num_pixels_read += n;
     return PF_OK;
 
 fail:
+    conn->num_pixels_lost += idx - curr_batch_start;
     DO_CLOSE(conn);
     return res;
 }
+
+enum pf_result
+pf_get_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size,
+    size_t batch_limit)
+{
+    size_t answered;
+    return pf_get_many_resumable(conn, pxs, n, buf, buf_size, batch_limit, &answered);
+}
+
+// --- resilient interface ---
+
+static bool
+is_retryable(enum pf_result res) {
+    switch (res) {
+        case PF_SYS_WRITE:
+        case PF_SYS_READ:
+        case PF_SYS_WRITE_RETURNED_ZERO:
+        case PF_SYS_READ_RETURNED_ZERO:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void
+resilient_sock_addr(struct pf_resilient *rc, struct sockaddr_in *sock_addr) {
+    memset(sock_addr, 0, sizeof(*sock_addr));
+    sock_addr->sin_family = AF_INET;
+    sock_addr->sin_port = rc->port;
+    sock_addr->sin_addr.s_addr = rc->addr;
+}
+
+// checks that an idle spare has not been closed by the server in the meantime.
+static bool
+spare_alive(int fd) {
+    char c;
+    ssize_t status = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    // an idle connection has nothing to read; EOF or unexpected data means it's unusable
+    return status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// tops up the spare pool. Best effort: a spare that can't be established now
+// is simply missing until the next refill.
+static void
+refill_spares(struct pf_resilient *rc) {
+    struct sockaddr_in sock_addr;
+    resilient_sock_addr(rc, &sock_addr);
+    while (rc->num_spares < rc->target_spares) {
+        int fd;
+        if (open_socket(&sock_addr, false, &fd) != PF_OK) {
+            return;
+        }
+        rc->spares[rc->num_spares++] = fd;
+    }
+}
+
+// replaces the (failed) active connection, preferring an established spare.
+// Doesn't refill the pool, so that the interrupted call can resume right away.
+static enum pf_result
+reconnect(struct pf_resilient *rc) {
+    DO_CLOSE(&rc->conn);
+    while (rc->num_spares > 0) {
+        int fd = rc->spares[--rc->num_spares];
+        if (spare_alive(fd)) {
+            rc->conn.sockfd = fd;
+            break;
+        }
+        close(fd);
+    }
+    if (rc->conn.sockfd == -1) {
+        // no spare left: cold connect, saving a round trip with TCP Fast Open if possible
+        struct sockaddr_in sock_addr;
+        resilient_sock_addr(rc, &sock_addr);
+        enum pf_result res;
+        if ((res = open_socket(&sock_addr, true, &rc->conn.sockfd)) != PF_OK) {
+            return res;
+        }
+    }
+    rc->conn.num_reconnects++;
+    return PF_OK;
+}
+
+enum pf_result
+pf_resilient_connect_raw(char *addr, char *port, size_t num_spares, size_t max_retries,
+    struct pf_resilient *rc)
+{
+    if (addr == NULL || port == NULL || rc == NULL) {
+        return PF_NULL_ARG;
+    }
+    memset(rc, 0, sizeof(*rc));
+    rc->conn.sockfd = -1;
+    if (num_spares > PF_MAX_SPARES) {
+        return PF_TOO_MANY_SPARES;
+    }
+    enum pf_result res = PF_OK;
+    struct sockaddr_in sock_addr;
+    if ((res = parse_addr(addr, port, &sock_addr)) != PF_OK) {
+        return res;
+    }
+    rc->addr = sock_addr.sin_addr.s_addr;
+    rc->port = sock_addr.sin_port;
+    rc->target_spares = num_spares;
+    rc->max_retries = max_retries;
+    if ((res = open_socket(&sock_addr, false, &rc->conn.sockfd)) != PF_OK) {
+        return res;
+    }
+    refill_spares(rc);
+    return PF_OK;
+}
+
+void
+pf_resilient_disconnect(struct pf_resilient *rc) {
+    if (rc != NULL) {
+        DO_CLOSE(&rc->conn);
+        while (rc->num_spares > 0) {
+            close(rc->spares[--rc->num_spares]);
+        }
+    }
+}
+
+static enum pf_result
+pf_resilient_put_general_many(struct pf_resilient *rc, struct pixel *pxs, size_t n, enum pf_format fmt,
+    char *buf, size_t buf_size)
+{
+    if (rc == NULL || pxs == NULL || buf == NULL) {
+        return PF_NULL_ARG;
+    }
+    enum pf_result res = PF_OK;
+    size_t done = 0;
+    size_t retries = 0;
+    size_t reconnects = rc->conn.num_reconnects;
+    while (1) {
+        size_t flushed = 0;
+        if (CONN_VALID(&rc->conn)) {
+            res = pf_put_general_many(&rc->conn, pxs + done, n - done, fmt,
+                buf, buf_size, &flushed);
+            done += flushed;
+            if (!is_retryable(res)) {
+                goto out;
+            }
+        }
+        if (retries++ == rc->max_retries) {
+            if (res == PF_OK) {
+                res = PF_CONN_INVALID_STATE;
+            }
+            goto out;
+        }
+        if ((res = reconnect(rc)) != PF_OK) {
+            goto out;
+        }
+    }
+out:
+    // replace used spares only after the batch is done, and only if we used any:
+    // refilling blocks in connect(), which a healthy call shouldn't pay for
+    if (rc->conn.num_reconnects != reconnects) {
+        refill_spares(rc);
+    }
+    return res;
+}
+
+enum pf_result
+pf_resilient_put_rgb_many(struct pf_resilient *rc, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size)
+{
+    return pf_resilient_put_general_many(rc, pxs, n, PF_FORMAT_RGB, buf, buf_size);
+}
+
+enum pf_result
+pf_resilient_put_rgba_many(struct pf_resilient *rc, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size)
+{
+    return pf_resilient_put_general_many(rc, pxs, n, PF_FORMAT_RGBA, buf, buf_size);
+}
+
+enum pf_result
+pf_resilient_put_auto_many(struct pf_resilient *rc, struct pixel *pxs, size_t n, bool allow_gray,
+    char *buf, size_t buf_size)
+{
+    if (pxs == NULL) {
+        return PF_NULL_ARG;
+    }
+    return pf_resilient_put_general_many(rc, pxs, n, pf_pick_format(pxs, n, allow_gray),
+        buf, buf_size);
+}
+
+enum pf_result
+pf_resilient_get_many(struct pf_resilient *rc, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size,
+    size_t batch_limit)
+{
+    if (rc == NULL || pxs == NULL || buf == NULL) {
+        return PF_NULL_ARG;
+    }
+    enum pf_result res = PF_OK;
+    size_t done = 0;
+    size_t retries = 0;
+    size_t reconnects = rc->conn.num_reconnects;
+    while (1) {
+        size_t answered = 0;
+        if (CONN_VALID(&rc->conn)) {
+            res = pf_get_many_resumable(&rc->conn, pxs + done, n - done,
+                buf, buf_size, batch_limit, &answered);
+            done += answered;
+            if (!is_retryable(res)) {
+                goto out;
+            }
+        }
+        if (retries++ == rc->max_retries) {
+            if (res == PF_OK) {
+                res = PF_CONN_INVALID_STATE;
+            }
+            goto out;
+        }
+        if ((res = reconnect(rc)) != PF_OK) {
+            goto out;
+        }
+    }
+out:
+    // replace used spares only after the batch is done, and only if we used any:
+    // refilling blocks in connect(), which a healthy call shouldn't pay for
+    if (rc->conn.num_reconnects != reconnects) {
+        refill_spares(rc);
+    }
+    return res;
+}
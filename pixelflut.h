@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #define PF_BUG_CATCHING
 
@@ -14,6 +15,8 @@ enum pf_result {
     // invalid arguments
     PF_CONN_INVALID_STATE,
     PF_NULL_ARG,
+    PF_INVALID_FORMAT,
+    PF_TOO_MANY_SPARES,
 
     // connection
     PF_CONNECT_PARSE_ADDR,
@@ -53,6 +56,11 @@ struct pf_conn {
     // accounting
     size_t num_pixels_written;
     size_t num_pixels_read;
+    // pixels whose commands were buffered or sent, but never confirmed as flushed
+    // (writes) or answered (reads) before the connection failed
+    size_t num_pixels_lost;
+    // number of times a failed connection was replaced (see `pf_resilient`)
+    size_t num_reconnects;
 };
 
 // TODO pf_connect with already-parsed port and/or address
@@ -77,6 +85,24 @@ struct pixel {
     uint8_t a;
 };
 
+// Color encoding of `PX` write commands.
+enum pf_format {
+    // `PX x y ww`, using only `r`. Not supported by every server.
+    PF_FORMAT_GRAY,
+    // `PX x y rrggbb`
+    PF_FORMAT_RGB,
+    // `PX x y rrggbbaa`
+    PF_FORMAT_RGBA,
+    // `PX x y rrggbb` if `a == 0xff`, `PX x y rrggbbaa` otherwise
+    PF_FORMAT_RGBA_OPAQUE,
+};
+
+// Returns the format that encodes all pixels correctly in the fewest bytes.
+// Grayscale is only chosen if `allow_gray` is set, all pixels have `r == g == b`
+// and are opaque.
+enum pf_format
+pf_pick_format(struct pixel *pxs, size_t n, bool allow_gray);
+
 // --- basic interface ---
 
 // Writes a pixel value, ignoring the alpha value.
@@ -89,6 +115,11 @@ pf_put_rgb(struct pf_conn *conn, struct pixel px);
 enum pf_result
 pf_put_rgba(struct pf_conn *conn, struct pixel px);
 
+// Writes a pixel value as grayscale, using only the red channel.
+// Connection is closed on error.
+enum pf_result
+pf_put_gray(struct pf_conn *conn, struct pixel px);
+
 // Reads the current canvas size.
 // `width` or `height` can be NULL to ignore the value.
 // Connection is closed on error.
@@ -124,6 +155,23 @@ enum pf_result
 pf_put_rgba_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
     char *buf, size_t buf_size);
 
+// Same as `pf_put_rgb_many`, but as grayscale, using only the red channel.
+enum pf_result
+pf_put_gray_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size);
+
+// Same as `pf_put_rgb_many`, but with the color format `fmt`.
+// The format is fixed for the whole call, so the per-pixel loop doesn't branch on it.
+enum pf_result
+pf_put_many(struct pf_conn *conn, struct pixel *pxs, size_t n, enum pf_format fmt,
+    char *buf, size_t buf_size);
+
+// Same as `pf_put_many`, with the format chosen by `pf_pick_format`.
+// This needs one extra pass over `pxs`.
+enum pf_result
+pf_put_auto_many(struct pf_conn *conn, struct pixel *pxs, size_t n, bool allow_gray,
+    char *buf, size_t buf_size);
+
 // Reads many pixel values in a buffered fashion.
 // - `pxs`: array of pixels
 // - `n`: number of pixels
@@ -151,4 +199,72 @@ pf_get_many(struct pf_conn *conn, struct pixel *pxs, size_t n,
     char *buf, size_t buf_size,
     size_t batch_limit);
 
+// --- resilient interface ---
+
+#define PF_MAX_SPARES 8
+
+// A connection that survives being kicked by the server.
+// Spare connections are established in advance. When an I/O error occurs, the failed
+// connection is replaced by a spare (or, if none is left, by a freshly connected one)
+// and the interrupted `*_many` call resumes from the last fully flushed pixel
+// (writes) or from the last fully answered batch (reads).
+// Used spares are replaced at the end of a call that reconnected, not while it is
+// interrupted. Replacing them is a blocking `connect()` per spare, so such a call can
+// take up to the kernel's connect timeout longer if the server doesn't accept us.
+// Note that "flushed" means handed to the kernel: data the server dropped when kicking
+// us can't be detected, as the protocol has no acknowledgements for writes.
+//
+// `conn` is the active connection. Its accounting (including `num_reconnects` and
+// `num_pixels_lost`) is carried over to every replacement.
+struct pf_resilient {
+    struct pf_conn conn;
+
+    // established, currently idle connections
+    int spares[PF_MAX_SPARES];
+    size_t num_spares;
+    // number of spares to keep established
+    size_t target_spares;
+    // how many reconnects a single call may perform before giving up
+    size_t max_retries;
+
+    // target, in network byte order
+    uint32_t addr;
+    uint16_t port;
+};
+
+// Like `pf_connect_raw`, but additionally establishes `num_spares` spare connections.
+// - `num_spares`: at most `PF_MAX_SPARES`
+// - `max_retries`: maximum number of reconnects per call
+enum pf_result
+pf_resilient_connect_raw(char *addr, char *port, size_t num_spares, size_t max_retries,
+    struct pf_resilient *rc);
+
+// Closes the active connection and all spares.
+void
+pf_resilient_disconnect(struct pf_resilient *rc);
+
+// Same as `pf_put_rgb_many`, but reconnects and resumes on I/O errors.
+// Only I/O errors (`PF_SYS_READ`, `PF_SYS_WRITE` and their `_RETURNED_ZERO` variants)
+// trigger a reconnect. All other errors are returned immediately.
+enum pf_result
+pf_resilient_put_rgb_many(struct pf_resilient *rc, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size);
+
+// Same as `pf_put_rgba_many`, but reconnects and resumes on I/O errors.
+enum pf_result
+pf_resilient_put_rgba_many(struct pf_resilient *rc, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size);
+
+// Same as `pf_put_auto_many`, but reconnects and resumes on I/O errors.
+enum pf_result
+pf_resilient_put_auto_many(struct pf_resilient *rc, struct pixel *pxs, size_t n, bool allow_gray,
+    char *buf, size_t buf_size);
+
+// Same as `pf_get_many`, but reconnects and resumes on I/O errors.
+// Batches that were not answered completely are requested again.
+enum pf_result
+pf_resilient_get_many(struct pf_resilient *rc, struct pixel *pxs, size_t n,
+    char *buf, size_t buf_size,
+    size_t batch_limit);
+
 #endif